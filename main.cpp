@@ -9,6 +9,15 @@
 #include <SDL_mixer.h>
 #include <SDL_ttf.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 
 const int SCREEN_WIDTH = 800;
@@ -16,6 +25,9 @@ const int SCREEN_HEIGHT = 600;
 const int TILE_SIZE = 40;
 const int MAP_WIDTH = SCREEN_WIDTH / TILE_SIZE;
 const int MAP_HEIGHT = SCREEN_HEIGHT / TILE_SIZE;
+// Ô xuất phát của player
+const int PLAYER_START_COL = (MAP_WIDTH - 1) / 2;
+const int PLAYER_START_ROW = MAP_HEIGHT - 2;
 
 // Thêm các hằng số cho menu
 const int MENU_WIDTH = 300;
@@ -23,6 +35,89 @@ const int MENU_HEIGHT = 200;
 const SDL_Color MENU_COLOR = {50, 50, 50, 255};
 const SDL_Color TEXT_COLOR = {255, 255, 255, 255};
 
+// Header của file lưu game (savegame.dat)
+const char SAVE_MAGIC[4] = {'B', 'C', 'S', 'V'};
+const Uint16 SAVE_VERSION = 2;
+
+// Bộ đếm chi phí vẽ của một frame: số lần gọi vẽ, số lần đổi texture, đổi màu và đổi blend mode.
+// Mọi lệnh vẽ đều đi qua các hàm draw*() bên dưới để được đếm.
+struct RenderStats {
+    int drawCalls;
+    int textureSwitches;
+    int colorChanges;
+    int blendModeChanges;
+    SDL_Texture* lastTexture;   // nullptr = vẽ không có texture
+    SDL_Color lastColor;
+    bool hasColor;
+    SDL_BlendMode lastBlendMode;
+
+    RenderStats() : lastTexture(nullptr), hasColor(false), lastBlendMode(SDL_BLENDMODE_NONE) {
+        reset();
+    }
+
+    // Gọi đầu mỗi frame; trạng thái renderer (texture, màu) vẫn giữ qua các frame
+    void reset() {
+        drawCalls = 0;
+        textureSwitches = 0;
+        colorChanges = 0;
+        blendModeChanges = 0;
+    }
+};
+
+RenderStats renderStats;
+
+inline void drawSetColor(SDL_Renderer* renderer, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    SDL_Color& last = renderStats.lastColor;
+    if (!renderStats.hasColor || last.r != r || last.g != g || last.b != b || last.a != a) {
+        renderStats.colorChanges++;
+        renderStats.lastColor = {r, g, b, a};
+        renderStats.hasColor = true;
+    }
+    SDL_SetRenderDrawColor(renderer, r, g, b, a);
+}
+
+inline void drawSetBlendMode(SDL_Renderer* renderer, SDL_BlendMode mode) {
+    if (mode != renderStats.lastBlendMode) {
+        renderStats.blendModeChanges++;
+        renderStats.lastBlendMode = mode;
+    }
+    SDL_SetRenderDrawBlendMode(renderer, mode);
+}
+
+// Đổi sang texture khác, kể cả giữa có và không có texture, đều tính là một lần đổi.
+// Mọi lệnh vẽ không texture (clear, fill rect, geometry NULL) đều gọi với nullptr.
+inline void countTextureSwitch(SDL_Texture* texture) {
+    if (texture != renderStats.lastTexture) {
+        renderStats.textureSwitches++;
+        renderStats.lastTexture = texture;
+    }
+}
+
+inline void drawClear(SDL_Renderer* renderer) {
+    renderStats.drawCalls++;
+    countTextureSwitch(nullptr);
+    SDL_RenderClear(renderer);
+}
+
+inline void drawFillRect(SDL_Renderer* renderer, const SDL_Rect* rect) {
+    renderStats.drawCalls++;
+    countTextureSwitch(nullptr);
+    SDL_RenderFillRect(renderer, rect);
+}
+
+inline void drawCopy(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* src, const SDL_Rect* dst) {
+    renderStats.drawCalls++;
+    countTextureSwitch(texture);
+    SDL_RenderCopy(renderer, texture, src, dst);
+}
+
+inline void drawGeometry(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Vertex* vertices,
+                         int numVertices, const int* indices, int numIndices) {
+    renderStats.drawCalls++;
+    countTextureSwitch(texture);
+    SDL_RenderGeometry(renderer, texture, vertices, numVertices, indices, numIndices);
+}
+
 class Wall {
 public:
     int x, y;
@@ -40,11 +135,11 @@ public:
         if(active) {
             if (texture) {
                 // Vẽ texture nếu có
-                SDL_RenderCopy(renderer, texture, NULL, &rect);
+                drawCopy(renderer, texture, NULL, &rect);
             } else {
                 // Fallback: Vẽ màu nâu nếu không có texture
-                SDL_SetRenderDrawColor(renderer, 150, 75, 0, 255);
-                SDL_RenderFillRect(renderer, &rect);
+                drawSetColor(renderer, 150, 75, 0, 255);
+                drawFillRect(renderer, &rect);
             }
         }
     }
@@ -79,8 +174,8 @@ public:
 
     void render(SDL_Renderer* renderer) {
         if (active) {
-            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-            SDL_RenderFillRect(renderer, &rect);
+            drawSetColor(renderer, 255, 255, 255, 255);
+            drawFillRect(renderer, &rect);
         }
     };
 };
@@ -139,11 +234,11 @@ public:
     void render(SDL_Renderer* renderer) {
         if (texture) {
             // Vẽ texture nếu có
-            SDL_RenderCopy(renderer, texture, NULL, &rect);
+            drawCopy(renderer, texture, NULL, &rect);
         } else {
             // Fallback: Vẽ màu vàng nếu không có texture
-            SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);
-            SDL_RenderFillRect(renderer, &rect);
+            drawSetColor(renderer, 255, 255, 0, 255);
+            drawFillRect(renderer, &rect);
         }
         // Vẽ đạn (giữ nguyên)
         for (auto &bullet : bullets) {
@@ -212,11 +307,12 @@ public:
         }
     }
 
-    void shoot() {
-        if (--shootDelay > 0) return;
+    bool shoot() {
+        if (--shootDelay > 0) return false;
         shootDelay = 5;
         bullets.push_back(Bullet(x + TILE_SIZE / 2 - 5, y + TILE_SIZE / 2 - 5,
         this->dirX, this->dirY));
+        return true;
     }
 
     void updateBullets() {
@@ -229,8 +325,8 @@ public:
 
     void render(SDL_Renderer* renderer) {
         if (active) {
-            SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-            SDL_RenderFillRect(renderer, &rect);
+            drawSetColor(renderer, 255, 0, 0, 255);
+            drawFillRect(renderer, &rect);
             for (auto &bullet : bullets) {
                 bullet.render(renderer);
             }
@@ -238,10 +334,561 @@ public:
     };
 };
 
+// Các loại hiệu ứng hạt
+enum ParticleEffect {
+    EFFECT_EXPLOSION,
+    EFFECT_DEBRIS,
+    EFFECT_MUZZLE_FLASH
+};
+
+// Hệ thống hạt: bể cố định dạng SoA (mỗi thuộc tính một mảng riêng).
+// Bể là vòng tròn, khi đầy thì hạt cũ nhất bị ghi đè.
+// Toàn bộ hạt được vẽ bằng một lần gọi SDL_RenderGeometry.
+class ParticleSystem {
+public:
+    static const int MAX_PARTICLES = 4096;
+    static const int PARTICLE_SIZE = 4;
+
+    float x[MAX_PARTICLES], y[MAX_PARTICLES];
+    float vx[MAX_PARTICLES], vy[MAX_PARTICLES];
+    float life[MAX_PARTICLES];      // Số frame còn lại, <= 0 là hạt đã chết
+    float invMaxLife[MAX_PARTICLES];
+    Uint8 r[MAX_PARTICLES], g[MAX_PARTICLES], b[MAX_PARTICLES];
+    int head;   // Vị trí ghi tiếp theo (cũng là hạt cũ nhất khi bể đầy)
+    int alive;  // Số hạt còn sống (ước lượng trên, dùng để bỏ qua sớm)
+
+    vector<SDL_Vertex> vertices;
+    vector<int> indices;
+
+    ParticleSystem() {
+        vertices.resize(MAX_PARTICLES * 4);
+        indices.resize(MAX_PARTICLES * 6);
+        // Chỉ số cho 2 tam giác mỗi hạt không đổi nên tạo sẵn một lần
+        for (int i = 0; i < MAX_PARTICLES; ++i) {
+            int v = i * 4;
+            int* idx = &indices[i * 6];
+            idx[0] = v; idx[1] = v + 1; idx[2] = v + 2;
+            idx[3] = v + 2; idx[4] = v + 3; idx[5] = v;
+        }
+        clear();
+    }
+
+    void clear() {
+        fill(life, life + MAX_PARTICLES, 0.0f);
+        head = 0;
+        alive = 0;
+    }
+
+    void emit(float px, float py, float pvx, float pvy, int frames, Uint8 cr, Uint8 cg, Uint8 cb) {
+        int i = head;
+        head = (head + 1) % MAX_PARTICLES;
+        if (life[i] <= 0.0f) alive++;
+        x[i] = px;
+        y[i] = py;
+        vx[i] = pvx;
+        vy[i] = pvy;
+        life[i] = (float)frames;
+        invMaxLife[i] = 1.0f / frames;
+        r[i] = cr;
+        g[i] = cg;
+        b[i] = cb;
+    }
+
+    // Tạo một hiệu ứng tại tâm (cx, cy); dirX/dirY chỉ dùng cho lửa đầu nòng
+    void spawn(ParticleEffect effect, int cx, int cy, int dirX = 0, int dirY = 0) {
+        switch (effect) {
+            case EFFECT_EXPLOSION:
+                for (int i = 0; i < 48; ++i) {
+                    float angle = (rand() % 360) * 0.0174533f;
+                    float speed = 0.5f + (rand() % 100) * 0.03f;
+                    Uint8 green = (Uint8)(80 + rand() % 150);
+                    emit(cx, cy, cos(angle) * speed, sin(angle) * speed, 20 + rand() % 20, 255, green, 0);
+                }
+                break;
+            case EFFECT_DEBRIS:
+                for (int i = 0; i < 24; ++i) {
+                    float angle = (rand() % 360) * 0.0174533f;
+                    float speed = 0.3f + (rand() % 100) * 0.02f;
+                    emit(cx, cy, cos(angle) * speed, sin(angle) * speed, 30 + rand() % 30, 150, 75, 0);
+                }
+                break;
+            case EFFECT_MUZZLE_FLASH:
+                for (int i = 0; i < 8; ++i) {
+                    float spread = ((rand() % 100) - 50) * 0.02f;
+                    float pvx = dirX * 0.4f + (dirX == 0 ? spread : 0.0f);
+                    float pvy = dirY * 0.4f + (dirY == 0 ? spread : 0.0f);
+                    emit(cx, cy, pvx, pvy, 4 + rand() % 4, 255, 255, 180);
+                }
+                break;
+        }
+    }
+
+    void update() {
+        if (alive == 0) return;
+        // Vòng lặp không rẽ nhánh trên mảng liên tục để trình biên dịch vector hóa.
+        // Hạt đã chết vẫn được tích phân nhưng không bao giờ được vẽ.
+        for (int i = 0; i < MAX_PARTICLES; ++i) {
+            x[i] += vx[i];
+            y[i] += vy[i];
+            vx[i] *= 0.92f;
+            vy[i] *= 0.92f;
+            life[i] -= 1.0f;
+        }
+        int count = 0;
+        for (int i = 0; i < MAX_PARTICLES; ++i) {
+            count += life[i] > 0.0f;
+        }
+        alive = count;
+    }
+
+    void render(SDL_Renderer* renderer) {
+        if (alive == 0) return;
+        int n = 0;
+        const float half = PARTICLE_SIZE / 2.0f;
+        for (int i = 0; i < MAX_PARTICLES; ++i) {
+            if (life[i] <= 0.0f) continue;
+            SDL_Color color = {r[i], g[i], b[i], (Uint8)(255.0f * life[i] * invMaxLife[i])};
+            SDL_Vertex* v = &vertices[n * 4];
+            v[0].position = {x[i] - half, y[i] - half};
+            v[1].position = {x[i] + half, y[i] - half};
+            v[2].position = {x[i] + half, y[i] + half};
+            v[3].position = {x[i] - half, y[i] + half};
+            for (int k = 0; k < 4; ++k) {
+                v[k].color = color;
+                v[k].tex_coord = {0.0f, 0.0f};
+            }
+            n++;
+        }
+        if (n == 0) return;
+
+        SDL_BlendMode oldMode;
+        SDL_GetRenderDrawBlendMode(renderer, &oldMode);
+        drawSetBlendMode(renderer, SDL_BLENDMODE_BLEND);
+        drawGeometry(renderer, NULL, vertices.data(), n * 4, indices.data(), n * 6);
+        drawSetBlendMode(renderer, oldMode);
+    }
+};
+
+// Các hiệu ứng âm thanh, giá trị càng lớn thì độ ưu tiên càng cao
+enum SoundEffect {
+    SOUND_SHOT,
+    SOUND_HIT,
+    SOUND_EXPLOSION,
+    SOUND_COUNT
+};
+
+// Quản lý hiệu ứng âm thanh: nạp và giải mã sẵn mọi Mix_Chunk lúc khởi động,
+// giới hạn số kênh phát cùng lúc, gộp các âm giống nhau trong cùng một tick
+// và bỏ âm có độ ưu tiên thấp khi hết kênh.
+class SoundManager {
+public:
+    static const int MAX_VOICES = 16;
+
+    Mix_Chunk* chunks[SOUND_COUNT];
+    bool pending[SOUND_COUNT];
+    int channelPriority[MAX_VOICES];
+
+    SoundManager() {
+        for (int i = 0; i < SOUND_COUNT; ++i) {
+            chunks[i] = nullptr;
+            pending[i] = false;
+        }
+        fill(channelPriority, channelPriority + MAX_VOICES, -1);
+    }
+
+    // Gọi sau Mix_OpenAudio
+    void load() {
+        Mix_AllocateChannels(MAX_VOICES);
+        const char* paths[SOUND_COUNT] = {
+            "assets/shot.wav",
+            "assets/hit.wav",
+            "assets/explosion.wav"
+        };
+        for (int i = 0; i < SOUND_COUNT; ++i) {
+            chunks[i] = Mix_LoadWAV(paths[i]);
+            if (!chunks[i]) {
+                cerr << "Failed to load sound " << paths[i] << "! Error: " << Mix_GetError() << endl;
+            }
+        }
+        // Tiếng bắn rất dày nên để nhỏ hơn
+        if (chunks[SOUND_SHOT]) Mix_VolumeChunk(chunks[SOUND_SHOT], 48);
+    }
+
+    // Chỉ đánh dấu yêu cầu, âm thật sự được phát trong flush()
+    void play(SoundEffect effect) {
+        pending[effect] = true;
+    }
+
+    // Phát các âm đã yêu cầu trong tick này, ưu tiên cao trước
+    void flush() {
+        for (int effect = SOUND_COUNT - 1; effect >= 0; --effect) {
+            if (!pending[effect]) continue;
+            pending[effect] = false;
+            if (!chunks[effect]) continue;
+
+            int channel = -1;
+            int lowest = effect;
+            for (int ch = 0; ch < MAX_VOICES; ++ch) {
+                if (!Mix_Playing(ch)) {
+                    channel = ch;
+                    break;
+                }
+                // Tìm kênh đang phát âm có ưu tiên thấp nhất để cướp
+                if (channelPriority[ch] < lowest) {
+                    lowest = channelPriority[ch];
+                    channel = ch;
+                }
+            }
+            if (channel < 0) continue; // Hết kênh, bỏ âm này
+
+            if (Mix_Playing(channel)) Mix_HaltChannel(channel);
+            if (Mix_PlayChannel(channel, chunks[effect], 0) >= 0) {
+                channelPriority[channel] = effect;
+            }
+        }
+    }
+
+    void free() {
+        for (int i = 0; i < SOUND_COUNT; ++i) {
+            if (chunks[i]) {
+                Mix_FreeChunk(chunks[i]);
+                chunks[i] = nullptr;
+            }
+        }
+    }
+};
+
+// Định dạng level nhị phân (.lvl), theo thứ tự:
+//   LevelHeader | LevelWave[waveCount] | LevelSpawn[spawnCount] | tiles[MAP_WIDTH * MAP_HEIGHT]
+// Mọi trường đều căn lề tự nhiên nên có thể đọc trực tiếp từ vùng nhớ mmap.
+// File .lvl được dịch sẵn từ file văn bản .txt bằng "game --compile-level" và được
+// phát hành cùng game; lúc chạy game chỉ đọc .lvl, không bao giờ ghi.
+const char LEVEL_MAGIC[4] = {'B', 'C', 'L', 'V'};
+const Uint16 LEVEL_VERSION = 1;
+const Uint8 TILE_EMPTY = 0;
+const Uint8 TILE_WALL = 1;
+
+struct LevelHeader {
+    char magic[4];
+    Uint16 version;
+    Uint8 width, height;
+    Uint16 waveCount;
+    Uint16 spawnCount;
+};
+
+struct LevelWave {
+    Uint16 enemyCount;
+    Uint16 delayFrames; // Số frame chờ sau khi wave trước bị tiêu diệt
+};
+
+struct LevelSpawn {
+    Uint8 x, y; // Tọa độ theo ô
+};
+
+// Ô nằm trong vùng chơi (không tính viền)
+inline bool isInsideMap(int col, int row) {
+    return col >= 1 && col < MAP_WIDTH - 1 && row >= 1 && row < MAP_HEIGHT - 1;
+}
+
+// File level được ánh xạ vào bộ nhớ (chỉ đọc)
+class LevelFile {
+public:
+    const Uint8* data;
+    size_t size;
+    const LevelHeader* header;
+    const LevelWave* waves;
+    const LevelSpawn* spawns;
+    const Uint8* tiles;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+
+    LevelFile() : data(nullptr), size(0), header(nullptr), waves(nullptr), spawns(nullptr), tiles(nullptr) {
+#ifdef _WIN32
+        mapping = NULL;
+#endif
+    }
+
+    ~LevelFile() {
+        close();
+    }
+
+    bool isOpen() const {
+        return data != nullptr;
+    }
+
+    // Trả về false (không báo lỗi) nếu file không tồn tại
+    bool open(const char* path) {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if (!mapping) return false;
+        data = (const Uint8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!data) {
+            CloseHandle(mapping);
+            mapping = NULL;
+            return false;
+        }
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        data = (const Uint8*)p;
+        size = (size_t)st.st_size;
+#endif
+
+        // Chỉ kiểm tra header, wave và điểm xuất hiện, không đọc từng ô
+        header = (const LevelHeader*)data;
+        size_t wavesOffset = sizeof(LevelHeader);
+        if (size < wavesOffset || memcmp(header->magic, LEVEL_MAGIC, 4) != 0 ||
+            header->version != LEVEL_VERSION ||
+            header->width != MAP_WIDTH || header->height != MAP_HEIGHT ||
+            header->waveCount == 0 || header->spawnCount == 0) {
+            cerr << "Invalid level file: " << path << endl;
+            close();
+            return false;
+        }
+        size_t spawnsOffset = wavesOffset + header->waveCount * sizeof(LevelWave);
+        size_t tilesOffset = spawnsOffset + header->spawnCount * sizeof(LevelSpawn);
+        if (size < tilesOffset + MAP_WIDTH * MAP_HEIGHT) {
+            cerr << "Truncated level file: " << path << endl;
+            close();
+            return false;
+        }
+        waves = (const LevelWave*)(data + wavesOffset);
+        spawns = (const LevelSpawn*)(data + spawnsOffset);
+        tiles = data + tilesOffset;
+        for (int i = 0; i < header->spawnCount; ++i) {
+            if (!isInsideMap(spawns[i].x, spawns[i].y)) {
+                cerr << "Spawn point out of map in level file: " << path << endl;
+                close();
+                return false;
+            }
+        }
+        // Mỗi địch trong wave cần một điểm xuất hiện riêng để không đè lên nhau
+        for (int i = 0; i < header->waveCount; ++i) {
+            if (waves[i].enemyCount > header->spawnCount) {
+                cerr << "Wave has more enemies than spawn points in level file: " << path << endl;
+                close();
+                return false;
+            }
+        }
+        if (tiles[PLAYER_START_ROW * MAP_WIDTH + PLAYER_START_COL] != TILE_EMPTY) {
+            cerr << "Player start tile is blocked in level file: " << path << endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (!data) return;
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        mapping = NULL;
+#else
+        munmap((void*)data, size);
+#endif
+        data = nullptr;
+        size = 0;
+        header = nullptr;
+        waves = nullptr;
+        spawns = nullptr;
+        tiles = nullptr;
+    }
+
+    // Chạm vào từng trang để hệ điều hành nạp file vào bộ nhớ trước khi cần
+    void prefetch() const {
+        if (!data) return;
+#ifndef _WIN32
+        madvise((void*)data, size, MADV_WILLNEED);
+#endif
+        volatile Uint8 sink = 0;
+        for (size_t i = 0; i < size; i += 4096) {
+            sink = sink + data[i];
+        }
+    }
+
+    void swap(LevelFile& other) {
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+        std::swap(header, other.header);
+        std::swap(waves, other.waves);
+        std::swap(spawns, other.spawns);
+        std::swap(tiles, other.tiles);
+#ifdef _WIN32
+        std::swap(mapping, other.mapping);
+#endif
+    }
+
+private:
+    LevelFile(const LevelFile&);
+    LevelFile& operator=(const LevelFile&);
+};
+
+// Dịch level từ file văn bản sang .lvl. Định dạng văn bản:
+//   # chú thích
+//   wave <số địch> <số frame chờ>
+//   map
+//   <MAP_HEIGHT dòng, mỗi dòng MAP_WIDTH ký tự: '.' trống, '#' tường, 'E' điểm xuất hiện địch>
+bool compileLevel(const char* textPath, const char* binaryPath) {
+    ifstream in(textPath);
+    if (!in) return false;
+
+    vector<LevelWave> waves;
+    vector<LevelSpawn> spawns;
+    vector<Uint8> tiles;
+    string line;
+    bool inMap = false;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || (!inMap && line[0] == '#')) continue;
+
+        if (!inMap) {
+            istringstream words(line);
+            string keyword;
+            words >> keyword;
+            if (keyword == "wave") {
+                long count = 0, delay = 0;
+                string extra;
+                words >> count >> delay;
+                if (!words || (words >> extra) || count <= 0 || count > 65535 || delay < 0 || delay > 65535) {
+                    cerr << textPath << ": invalid wave (expected 'wave <1..65535> <0..65535>'): " << line << endl;
+                    return false;
+                }
+                waves.push_back({(Uint16)count, (Uint16)delay});
+            } else if (keyword == "map") {
+                inMap = true;
+            } else {
+                cerr << textPath << ": unknown keyword: " << keyword << endl;
+                return false;
+            }
+            continue;
+        }
+
+        int row = tiles.size() / MAP_WIDTH;
+        if ((int)line.size() != MAP_WIDTH || row >= MAP_HEIGHT) {
+            cerr << textPath << ": map must be " << MAP_WIDTH << "x" << MAP_HEIGHT << endl;
+            return false;
+        }
+        for (int col = 0; col < MAP_WIDTH; ++col) {
+            char c = line[col];
+            if (c != '.' && c != '#' && c != 'E') {
+                cerr << textPath << ": unknown tile '" << c << "' at " << col << "," << row << endl;
+                return false;
+            }
+            if (c != '.' && col == PLAYER_START_COL && row == PLAYER_START_ROW) {
+                cerr << textPath << ": player start tile " << col << "," << row << " must be empty" << endl;
+                return false;
+            }
+            if (c == 'E') {
+                if (!isInsideMap(col, row)) {
+                    cerr << textPath << ": spawn point on the map border at " << col << "," << row << endl;
+                    return false;
+                }
+                spawns.push_back({(Uint8)col, (Uint8)row});
+            }
+            tiles.push_back(c == '#' ? TILE_WALL : TILE_EMPTY);
+        }
+    }
+
+    if ((int)tiles.size() != MAP_WIDTH * MAP_HEIGHT || waves.empty() || spawns.empty()) {
+        cerr << textPath << ": level needs a full map, at least one wave and one spawn point" << endl;
+        return false;
+    }
+    if (waves.size() > 65535) {
+        cerr << textPath << ": too many waves" << endl;
+        return false;
+    }
+    for (const auto& wave : waves) {
+        if (wave.enemyCount > spawns.size()) {
+            cerr << textPath << ": wave of " << wave.enemyCount << " enemies needs as many spawn points, level has "
+                 << spawns.size() << endl;
+            return false;
+        }
+    }
+
+    LevelHeader header;
+    memcpy(header.magic, LEVEL_MAGIC, 4);
+    header.version = LEVEL_VERSION;
+    header.width = MAP_WIDTH;
+    header.height = MAP_HEIGHT;
+    header.waveCount = waves.size();
+    header.spawnCount = spawns.size();
+
+    ofstream out(binaryPath, ios::binary);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(waves.data()), waves.size() * sizeof(LevelWave));
+    out.write(reinterpret_cast<const char*>(spawns.data()), spawns.size() * sizeof(LevelSpawn));
+    out.write(reinterpret_cast<const char*>(tiles.data()), tiles.size());
+    return out.good();
+}
+
+// Mở levels/levelNNN.lvl
+bool openLevel(LevelFile& level, int index) {
+    char path[64];
+    SDL_snprintf(path, sizeof(path), "levels/level%03d.lvl", index);
+    return level.open(path);
+}
+
+// Nạp trước level tiếp theo ở luồng nền trong lúc đang chơi
+struct LevelPrefetch {
+    LevelFile level;
+    int index;
+    bool ok;
+    SDL_Thread* thread;
+
+    LevelPrefetch() : index(0), ok(false), thread(nullptr) {}
+
+    static int run(void* data) {
+        LevelPrefetch* self = (LevelPrefetch*)data;
+        self->ok = openLevel(self->level, self->index);
+        if (self->ok) self->level.prefetch();
+        return 0;
+    }
+
+    void start(int levelIndex) {
+        wait();
+        level.close();
+        index = levelIndex;
+        ok = false;
+        thread = SDL_CreateThread(run, "LevelPrefetch", this);
+        if (!thread) run(this); // Không tạo được luồng thì nạp luôn
+    }
+
+    void wait() {
+        if (thread) {
+            SDL_WaitThread(thread, NULL);
+            thread = nullptr;
+        }
+    }
+};
+
 class Game {
 public:
     SDL_Window* window;
     SDL_Renderer* renderer;
+    SDL_Surface* offscreen; // Chỉ dùng ở chế độ headless
+    bool headless;
     bool running;
     bool inMenu;
     bool gamePaused;
@@ -252,65 +899,98 @@ public:
     SDL_Texture* wallTexture;
     SDL_Texture* playerTexture;
     Mix_Music* backgroundMusic;
+    ParticleSystem particles;
+    SoundManager sounds;
+    LevelFile level;
+    LevelPrefetch nextLevel;
+    int levelIndex = 1;
+    int waveIndex = 0;
+    int waveTimer = 0;
+    int deathTimer = 0; // Số frame còn lại của vụ nổ khi player bị bắn trúng
 
     // Constructor
-    Game(): player(((MAP_WIDTH - 1) / 2) * TILE_SIZE, (MAP_HEIGHT - 2) * TILE_SIZE, nullptr) {
+    // headless = true: vẽ vào surface trong bộ nhớ bằng renderer phần mềm, không cần
+    // GPU, màn hình hay âm thanh (dùng cho benchmark)
+    Game(bool headless = false): player(PLAYER_START_COL * TILE_SIZE, PLAYER_START_ROW * TILE_SIZE, nullptr) {
+        this->headless = headless;
         running = true;
-        inMenu = true;
+        inMenu = !headless;
         gamePaused = false;
+        window = nullptr;
+        offscreen = nullptr;
+        backgroundMusic = nullptr;
+
+        if (headless) {
+            offscreen = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+            renderer = offscreen ? SDL_CreateSoftwareRenderer(offscreen) : nullptr;
+            if (!renderer) {
+                cerr << "Offscreen renderer could not be created! SDL_Error: " << SDL_GetError() << endl;
+                running = false;
+            }
+        } else {
+            if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+                cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << endl;
+                running = false;
+            }
 
-        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-            cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << endl;
-            running = false;
-        }
-
-        window = SDL_CreateWindow("Battle City", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                 SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-        if (!window) {
-            cerr << "Window could not be created! SDL_Error: " << SDL_GetError() << endl;
-            running = false;
-        }
+            window = SDL_CreateWindow("Battle City", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                     SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+            if (!window) {
+                cerr << "Window could not be created! SDL_Error: " << SDL_GetError() << endl;
+                running = false;
+            }
 
-        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-        if (!renderer) {
-            cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << endl;
-            running = false;
+            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+            if (!renderer) {
+                cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << endl;
+                running = false;
+            }
         }
 
         // Load texture sau khi có renderer
-        wallTexture = IMG_LoadTexture(renderer, "assets/wall.png");
-        playerTexture = IMG_LoadTexture(renderer, "assets/player_tank.png");
-
-        player.texture = playerTexture;
-        // Kiểm tra lỗi
-        if (!wallTexture || !playerTexture) {
-            std::cerr << "Warning: Failed to load textures! Using fallback colors.\n";
+        // Headless không đọc file nào để hình ảnh không phụ thuộc thư mục chạy
+        wallTexture = nullptr;
+        playerTexture = nullptr;
+        if (!headless) {
+            wallTexture = IMG_LoadTexture(renderer, "assets/wall.png");
+            playerTexture = IMG_LoadTexture(renderer, "assets/player_tank.png");
+
+            // Kiểm tra lỗi
+            if (!wallTexture || !playerTexture) {
+                std::cerr << "Warning: Failed to load textures! Using fallback colors.\n";
+            }
         }
+        player.texture = playerTexture;
 
-        if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0) {
-            cerr << "SDL_mixer could not initialize! Error: " << Mix_GetError() << endl;
-            running = false;
-        }
+        if (!headless) {
+            if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0) {
+                cerr << "SDL_mixer could not initialize! Error: " << Mix_GetError() << endl;
+                running = false;
+            } else {
+                sounds.load();
+            }
 
-        backgroundMusic = Mix_LoadMUS("assets/background.mp3");
+            backgroundMusic = Mix_LoadMUS("assets/background.mp3");
             if (!backgroundMusic) {
-            cerr << "Failed to load background music! Error: " << Mix_GetError() << endl;
+                cerr << "Failed to load background music! Error: " << Mix_GetError() << endl;
+            }
         }
 
-        if (TTF_Init() == -1) {
-            cerr << "SDL_ttf could not initialize! Error: " << TTF_GetError() << endl;
-            running = false;
-        }
+        if (!headless) {
+            if (TTF_Init() == -1) {
+                cerr << "SDL_ttf could not initialize! Error: " << TTF_GetError() << endl;
+                running = false;
+            }
 
-        // Load font (thay đổi đường dẫn tới file font của bạn)
-        TTF_Font* font = TTF_OpenFont("assets/font.ttf", 24);
+            // Load font (thay đổi đường dẫn tới file font của bạn)
+            TTF_Font* font = TTF_OpenFont("assets/font.ttf", 24);
             if (!font) {
-            cerr << "Failed to load font! Error: " << TTF_GetError() << endl;
+                cerr << "Failed to load font! Error: " << TTF_GetError() << endl;
+            }
         }
 
 
-        generateWalls();
-        spawnEnemies();
+        startLevel(1);
     }
 
     // Hàm hiển thị menu
@@ -319,8 +999,8 @@ public:
         SDL_Rect menuRect = {(SCREEN_WIDTH - MENU_WIDTH) / 2,
                              (SCREEN_HEIGHT - MENU_HEIGHT) / 2,
                              MENU_WIDTH, MENU_HEIGHT};
-        SDL_SetRenderDrawColor(renderer, MENU_COLOR.r, MENU_COLOR.g, MENU_COLOR.b, MENU_COLOR.a);
-        SDL_RenderFillRect(renderer, &menuRect);
+        drawSetColor(renderer, MENU_COLOR.r, MENU_COLOR.g, MENU_COLOR.b, MENU_COLOR.a);
+        drawFillRect(renderer, &menuRect);
 
         // Vẽ các nút (đơn giản chỉ là text)
         // Ở đây cần thêm SDL_ttf để hiển thị text đẹp hơn, nhưng để đơn giản tôi chỉ vẽ các hình chữ nhật
@@ -328,15 +1008,23 @@ public:
         SDL_Rect loadGameBtn = {menuRect.x + 50, menuRect.y + 80, 200, 40};
         SDL_Rect exitBtn = {menuRect.x + 50, menuRect.y + 130, 200, 40};
 
-        SDL_SetRenderDrawColor(renderer, 70, 70, 70, 255);
-        SDL_RenderFillRect(renderer, &newGameBtn);
-        SDL_RenderFillRect(renderer, &loadGameBtn);
-        SDL_RenderFillRect(renderer, &exitBtn);
+        drawSetColor(renderer, 70, 70, 70, 255);
+        drawFillRect(renderer, &newGameBtn);
+        drawFillRect(renderer, &loadGameBtn);
+        drawFillRect(renderer, &exitBtn);
 
         // Cần thêm SDL_ttf để hiển thị text
         // Đây chỉ là minh họa, bạn nên thêm thư viện SDL_ttf để hiển thị text đẹp hơn
     }
 
+    // Vẽ cả frame menu
+    void renderMenuFrame() {
+        drawSetColor(renderer, 0, 0, 0, 255);
+        drawClear(renderer);
+        renderMenu();
+        SDL_RenderPresent(renderer);
+    }
+
     // Hàm xử lý sự kiện menu
     void handleMenuEvents(SDL_Event& event) {
         if (event.type == SDL_MOUSEBUTTONDOWN) {
@@ -380,6 +1068,16 @@ public:
             return;
         }
 
+        // Header để nhận ra file lưu hỏng hoặc của phiên bản cũ
+        Uint16 version = SAVE_VERSION;
+        saveFile.write(SAVE_MAGIC, sizeof(SAVE_MAGIC));
+        saveFile.write(reinterpret_cast<char*>(&version), sizeof(version));
+
+        // Lưu level và wave hiện tại
+        saveFile.write(reinterpret_cast<char*>(&levelIndex), sizeof(levelIndex));
+        saveFile.write(reinterpret_cast<char*>(&waveIndex), sizeof(waveIndex));
+        saveFile.write(reinterpret_cast<char*>(&waveTimer), sizeof(waveTimer));
+
         // Lưu trạng thái player
         saveFile.write(reinterpret_cast<char*>(&player.x), sizeof(player.x));
         saveFile.write(reinterpret_cast<char*>(&player.y), sizeof(player.y));
@@ -441,10 +1139,45 @@ public:
             return;
         }
 
+        // File lưu hỏng, thiếu dữ liệu hoặc của phiên bản cũ: bắt đầu game mới
+        auto loadFailed = [this]() {
+            cerr << "Save file is corrupted or from an older version!" << endl;
+            resetGame();
+        };
+
+        char magic[4];
+        Uint16 version = 0;
+        loadFile.read(magic, sizeof(magic));
+        loadFile.read(reinterpret_cast<char*>(&version), sizeof(version));
+        if (!loadFile || memcmp(magic, SAVE_MAGIC, sizeof(magic)) != 0 || version != SAVE_VERSION) {
+            loadFailed();
+            return;
+        }
+
         // Xóa các đối tượng hiện tại
         walls.clear();
         enemies.clear();
         player.bullets.clear();
+        particles.clear();
+        deathTimer = 0;
+
+        // Load level và wave, ánh xạ lại đúng file level đã lưu
+        loadFile.read(reinterpret_cast<char*>(&levelIndex), sizeof(levelIndex));
+        loadFile.read(reinterpret_cast<char*>(&waveIndex), sizeof(waveIndex));
+        loadFile.read(reinterpret_cast<char*>(&waveTimer), sizeof(waveTimer));
+        if (!loadFile) {
+            loadFailed();
+            return;
+        }
+        if (openLevel(level, levelIndex)) {
+            waveIndex = min(max(waveIndex, 0), level.header->waveCount - 1);
+            nextLevel.start(levelIndex + 1);
+        } else {
+            // Không có file level: bản đồ mặc định, không có level tiếp theo
+            nextLevel.wait();
+            nextLevel.level.close();
+            nextLevel.ok = false;
+        }
 
         // Load player
         loadFile.read(reinterpret_cast<char*>(&player.x), sizeof(player.x));
@@ -456,6 +1189,10 @@ public:
         // Load player bullets
         size_t playerBulletCount;
         loadFile.read(reinterpret_cast<char*>(&playerBulletCount), sizeof(playerBulletCount));
+        if (!loadFile) {
+            loadFailed();
+            return;
+        }
         for (size_t i = 0; i < playerBulletCount; ++i) {
             int x, y, dx, dy;
             bool active;
@@ -464,24 +1201,40 @@ public:
             loadFile.read(reinterpret_cast<char*>(&dx), sizeof(dx));
             loadFile.read(reinterpret_cast<char*>(&dy), sizeof(dy));
             loadFile.read(reinterpret_cast<char*>(&active), sizeof(active));
+            if (!loadFile) {
+                loadFailed();
+                return;
+            }
             player.bullets.push_back(Bullet(x, y, dx, dy, active));
         }
 
         // Load walls
         size_t wallCount;
         loadFile.read(reinterpret_cast<char*>(&wallCount), sizeof(wallCount));
+        if (!loadFile) {
+            loadFailed();
+            return;
+        }
         for (size_t i = 0; i < wallCount; ++i) {
             int x, y;
             bool active;
             loadFile.read(reinterpret_cast<char*>(&x), sizeof(x));
             loadFile.read(reinterpret_cast<char*>(&y), sizeof(y));
             loadFile.read(reinterpret_cast<char*>(&active), sizeof(active));
+            if (!loadFile) {
+                loadFailed();
+                return;
+            }
             walls.emplace_back(x, y, wallTexture, active);
         }
 
         // Load enemies
         size_t enemyCount;
         loadFile.read(reinterpret_cast<char*>(&enemyCount), sizeof(enemyCount));
+        if (!loadFile) {
+            loadFailed();
+            return;
+        }
         for (size_t i = 0; i < enemyCount; ++i) {
             int x, y, dirX, dirY;
             bool active;
@@ -496,6 +1249,10 @@ public:
             // Load enemy bullets
             size_t enemyBulletCount;
             loadFile.read(reinterpret_cast<char*>(&enemyBulletCount), sizeof(enemyBulletCount));
+            if (!loadFile) {
+                loadFailed();
+                return;
+            }
             for (size_t j = 0; j < enemyBulletCount; ++j) {
                 int x, y, dx, dy;
                 bool active;
@@ -504,6 +1261,10 @@ public:
                 loadFile.read(reinterpret_cast<char*>(&dx), sizeof(dx));
                 loadFile.read(reinterpret_cast<char*>(&dy), sizeof(dy));
                 loadFile.read(reinterpret_cast<char*>(&active), sizeof(active));
+                if (!loadFile) {
+                    loadFailed();
+                    return;
+                }
                 enemy.bullets.push_back(Bullet(x, y, dx, dy, active));
             }
 
@@ -514,30 +1275,55 @@ public:
         cout << "Game loaded successfully!" << endl;
     }
 
-    // Hàm reset game
-    void resetGame() {
+    // Bắt đầu level, dùng bản đã nạp trước nếu có.
+    // Headless luôn dùng bản đồ mặc định, không mở file level.
+    void startLevel(int index) {
+        levelIndex = index;
+        nextLevel.wait();
+        if (headless) {
+            level.close();
+        } else if (nextLevel.ok && nextLevel.index == index) {
+            level.swap(nextLevel.level);
+            nextLevel.ok = false;
+        } else {
+            openLevel(level, index);
+        }
+
         walls.clear();
         enemies.clear();
         player.bullets.clear();
+        particles.clear();
 
         generateWalls();
-        player = PlayerTank(((MAP_WIDTH - 1) / 2) * TILE_SIZE, (MAP_HEIGHT - 2) * TILE_SIZE, playerTexture);
+        player = PlayerTank(PLAYER_START_COL * TILE_SIZE, PLAYER_START_ROW * TILE_SIZE, playerTexture);
+        waveIndex = 0;
+        waveTimer = 0;
+        deathTimer = 0;
         spawnEnemies();
 
+        if (level.isOpen()) {
+            nextLevel.start(index + 1);
+        }
+    }
+
+    // Hàm reset game
+    void resetGame() {
+        startLevel(1);
+
         if (backgroundMusic) {
             Mix_PlayMusic(backgroundMusic, -1);  // -1 = lặp vô hạn
         }
     }
 
     void render() {
-        SDL_SetRenderDrawColor(renderer, 128, 128, 128, 255); // boundaries
-        SDL_RenderClear(renderer); // delete color
+        drawSetColor(renderer, 128, 128, 128, 255); // boundaries
+        drawClear(renderer); // delete color
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        drawSetColor(renderer, 0, 0, 0, 255);
         for (int i = 1; i < MAP_HEIGHT - 1; ++i) {
             for (int j = 1; j < MAP_WIDTH - 1; ++j) {
                 SDL_Rect tile = { j * TILE_SIZE, i * TILE_SIZE, TILE_SIZE, TILE_SIZE };
-                SDL_RenderFillRect(renderer, &tile);
+                drawFillRect(renderer, &tile);
             }
         }
 
@@ -545,16 +1331,32 @@ public:
             walls[i].render(renderer);
         }
 
-        player.render(renderer);
+        if (deathTimer == 0) {
+            player.render(renderer);
+        }
 
         for (auto &enemy : enemies) {
             enemy.render(renderer);
         }
 
+        particles.render(renderer);
+
         SDL_RenderPresent(renderer);
     }
 
     void generateWalls(){
+        if (level.isOpen()) {
+            for (int i = 0; i < MAP_HEIGHT; ++i) {
+                for (int j = 0; j < MAP_WIDTH; ++j) {
+                    if (level.tiles[i * MAP_WIDTH + j] == TILE_WALL) {
+                        walls.push_back(Wall(j * TILE_SIZE, i * TILE_SIZE, wallTexture, true));
+                    }
+                }
+            }
+            return;
+        }
+
+        // Không có file level: dùng bản đồ mặc định
             for(int i = 3; i < MAP_HEIGHT - 3; i += 2) {
             for(int j = 3; j < MAP_WIDTH - 3; j += 2) {
                 walls.push_back(Wall(j * TILE_SIZE, i * TILE_SIZE, wallTexture, true));
@@ -568,6 +1370,8 @@ public:
             if (event.type == SDL_QUIT) {
                 running = false;
             } else if (event.type == SDL_KEYDOWN) {
+                // Player đang nổ: bỏ qua mọi phím (di chuyển, bắn, lưu...) cho tới khi game kết thúc
+                if (deathTimer > 0) continue;
                 switch (event.key.keysym.sym) {
                     case SDLK_UP:
                         player.move(0, -5, walls);
@@ -582,7 +1386,12 @@ public:
                         player.move(5, 0, walls);
                         break;
                     case SDLK_SPACE:
+                        // Không bắn khi đang pause
+                        if (gamePaused) break;
                         player.shoot();
+                        sounds.play(SOUND_SHOT);
+                        particles.spawn(EFFECT_MUZZLE_FLASH, player.x + TILE_SIZE / 2, player.y + TILE_SIZE / 2,
+                                        player.dirX, player.dirY);
                         break;
                     case SDLK_s: // Nhấn 's' để lưu game
                         saveGame();
@@ -594,8 +1403,10 @@ public:
                         gamePaused = !gamePaused;
                         if (gamePaused) {
                             Mix_PauseMusic();  // Tạm dừng nhạc
+                            Mix_Pause(-1);     // Tạm dừng hiệu ứng âm thanh
                         } else {
                             Mix_ResumeMusic();  // Tiếp tục nhạc
+                            Mix_Resume(-1);
                         }
                         break;
                     case SDLK_ESCAPE: // Nhấn ESC để vào menu
@@ -606,17 +1417,32 @@ public:
         }
     }
 
-    void update() {
+    // collisions = false: chỉ di chuyển và bắn, bỏ qua va chạm (dùng cho benchmark)
+    void update(bool collisions = true) {
         if (gamePaused || inMenu) return;
 
-        player.updateBullets();
+        if (deathTimer > 0) {
+            // Cho vụ nổ của player chạy hết rồi mới kết thúc game
+            particles.update();
+            if (--deathTimer == 0) {
+                running = false;
+            }
+            return;
+        }
 
-        for (auto& bullet : player.bullets) {
-            for (auto& enemy : enemies) {
-                if (enemy.active && SDL_HasIntersection(&bullet.rect, &enemy.rect)) {
-                    enemy.active = false;
-                    bullet.active = false;
-                    break;
+        player.updateBullets();
+        particles.update();
+
+        if (collisions) {
+            for (auto& bullet : player.bullets) {
+                for (auto& enemy : enemies) {
+                    if (enemy.active && SDL_HasIntersection(&bullet.rect, &enemy.rect)) {
+                        enemy.active = false;
+                        bullet.active = false;
+                        particles.spawn(EFFECT_EXPLOSION, enemy.x + TILE_SIZE / 2, enemy.y + TILE_SIZE / 2);
+                        sounds.play(SOUND_EXPLOSION);
+                        break;
+                    }
                 }
             }
         }
@@ -624,16 +1450,22 @@ public:
         for(auto& enemy : enemies) {
             enemy.move(walls);
             enemy.updateBullets();
-            if (rand() % 100 < 2) {
-                enemy.shoot();
+            if (rand() % 100 < 2 && enemy.shoot()) {
+                particles.spawn(EFFECT_MUZZLE_FLASH, enemy.x + TILE_SIZE / 2, enemy.y + TILE_SIZE / 2,
+                                enemy.dirX, enemy.dirY);
+                sounds.play(SOUND_SHOT);
             }
         }
 
+        if (!collisions) return;
+
         for (auto& bullet : player.bullets){
             for (auto& wall : walls) {
                 if (wall.active && SDL_HasIntersection(&bullet.rect, &wall.rect)) {
                     wall.active = false;
                     bullet.active = false;
+                    particles.spawn(EFFECT_DEBRIS, wall.x + TILE_SIZE / 2, wall.y + TILE_SIZE / 2);
+                    sounds.play(SOUND_HIT);
                     break;
                 }
             }
@@ -644,6 +1476,8 @@ public:
                 if (wall.active && SDL_HasIntersection(&bullet.rect, &wall.rect)) {
                     wall.active = false;
                     bullet.active = false;
+                    particles.spawn(EFFECT_DEBRIS, wall.x + TILE_SIZE / 2, wall.y + TILE_SIZE / 2);
+                    sounds.play(SOUND_HIT);
                     break;
                 }
             }
@@ -652,13 +1486,29 @@ public:
         enemies.erase(std::remove_if(enemies.begin(), enemies.end(),
                 [](EnemyTank &e) { return !e.active; } ),enemies.end());
         if (enemies.empty()) {
-            running = false;
+            if (level.isOpen() && waveIndex + 1 < level.header->waveCount) {
+                // Chờ rồi tung wave tiếp theo
+                if (++waveTimer >= level.waves[waveIndex + 1].delayFrames) {
+                    waveIndex++;
+                    waveTimer = 0;
+                    spawnEnemies();
+                }
+            } else {
+                nextLevel.wait();
+                if (nextLevel.ok) {
+                    startLevel(levelIndex + 1);
+                } else {
+                    running = false;
+                }
+            }
         }
 
         for (auto& enemy : enemies) {
             for (auto& bullet : enemy.bullets) {
                 if (SDL_HasIntersection(&bullet.rect, &player.rect)) {
-                    running = false;
+                    particles.spawn(EFFECT_EXPLOSION, player.x + TILE_SIZE / 2, player.y + TILE_SIZE / 2);
+                    sounds.play(SOUND_EXPLOSION);
+                    deathTimer = 60;
                     return;
                 }
             }
@@ -667,6 +1517,15 @@ public:
 
     void spawnEnemies() {
         enemies.clear();
+        if (level.isOpen()) {
+            const LevelWave& wave = level.waves[waveIndex];
+            for (int i = 0; i < wave.enemyCount; ++i) {
+                const LevelSpawn& spawn = level.spawns[i % level.header->spawnCount];
+                enemies.push_back(EnemyTank(spawn.x * TILE_SIZE, spawn.y * TILE_SIZE));
+            }
+            return;
+        }
+
         for (int i = 0; i < enemyNumber; ++i) {
             int ex, ey;
             bool validPosition = false;
@@ -696,15 +1555,12 @@ public:
                     handleMenuEvents(event);
                 }
 
-                // Render menu
-                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-                SDL_RenderClear(renderer);
-                renderMenu();
-                SDL_RenderPresent(renderer);
+                renderMenuFrame();
             } else {
                 handleEvents();
                 if (!gamePaused) {
                     update();
+                    sounds.flush();
                 }
                 render();
             }
@@ -713,19 +1569,141 @@ public:
     }
 
     ~Game() {
+        nextLevel.wait();
         if (backgroundMusic) {
             Mix_FreeMusic(backgroundMusic);  // Giải phóng nhạc
         }
+        sounds.free();
         Mix_CloseAudio();
         if (wallTexture) SDL_DestroyTexture(wallTexture);
         if (playerTexture) SDL_DestroyTexture(playerTexture);
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
+        if (renderer) SDL_DestroyRenderer(renderer);
+        if (window) SDL_DestroyWindow(window);
+        if (offscreen) SDL_FreeSurface(offscreen);
         SDL_Quit();
     }
 };
 
+// Benchmark vẽ không cần GPU/màn hình, chạy một cảnh cố định với số địch cho trước.
+// Cảnh dùng bản đồ mặc định và không đọc/ghi file nào ngoài ảnh frame được yêu cầu.
+// In CSV mỗi frame (dòng đầu là frame menu) và tổng kết ở cuối (dòng bắt đầu bằng '#').
+// Nếu có dumpPrefix thì lưu mỗi frame thành <dumpPrefix>_NNNN.bmp để so với ảnh chuẩn.
+int runBenchmark(int enemyCount, int frames, const char* dumpPrefix) {
+    srand(12345); // Cố định để các lần chạy cho cùng một hình ảnh
+    Game game(true);
+    if (!game.running) return 1;
+
+    // Đặt địch lần lượt lên các ô trống
+    vector<SDL_Rect> freeTiles;
+    for (int i = 1; i < MAP_HEIGHT - 1; ++i) {
+        for (int j = 1; j < MAP_WIDTH - 1; ++j) {
+            SDL_Rect tile = {j * TILE_SIZE, i * TILE_SIZE, TILE_SIZE, TILE_SIZE};
+            bool blocked = SDL_HasIntersection(&tile, &game.player.rect);
+            for (const auto& wall : game.walls) {
+                if (wall.active && SDL_HasIntersection(&tile, &wall.rect)) {
+                    blocked = true;
+                    break;
+                }
+            }
+            if (!blocked) freeTiles.push_back(tile);
+        }
+    }
+    game.enemies.clear();
+    for (int i = 0; i < enemyCount; ++i) {
+        const SDL_Rect& tile = freeTiles[i % freeTiles.size()];
+        game.enemies.push_back(EnemyTank(tile.x, tile.y));
+    }
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    cout << "frame,ms,draw_calls,texture_switches,color_changes,blend_mode_changes" << endl;
+    cout << fixed << setprecision(3);
+
+    renderStats.reset();
+    Uint64 start = SDL_GetPerformanceCounter();
+    game.renderMenuFrame();
+    double menuMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+    cout << "menu," << menuMs << "," << renderStats.drawCalls << "," << renderStats.textureSwitches << ","
+         << renderStats.colorChanges << "," << renderStats.blendModeChanges << endl;
+
+    double totalMs = 0, maxMs = 0;
+    long long totalDrawCalls = 0, totalTextureSwitches = 0, totalColorChanges = 0, totalBlendModeChanges = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        // Kịch bản: player bắn mỗi 15 frame, một vụ nổ mỗi 10 frame
+        if (frame % 15 == 0) {
+            game.player.shoot();
+            game.particles.spawn(EFFECT_MUZZLE_FLASH, game.player.x + TILE_SIZE / 2, game.player.y + TILE_SIZE / 2,
+                                 game.player.dirX, game.player.dirY);
+        }
+        // Dùng update thật nhưng bỏ qua va chạm để cảnh không kết thúc giữa chừng
+        game.update(false);
+        if (frame % 10 == 0 && !game.enemies.empty()) {
+            const EnemyTank& target = game.enemies[rand() % game.enemies.size()];
+            game.particles.spawn(EFFECT_EXPLOSION, target.x + TILE_SIZE / 2, target.y + TILE_SIZE / 2);
+        }
+
+        renderStats.reset();
+        start = SDL_GetPerformanceCounter();
+        game.render();
+        double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+
+        totalMs += ms;
+        maxMs = max(maxMs, ms);
+        totalDrawCalls += renderStats.drawCalls;
+        totalTextureSwitches += renderStats.textureSwitches;
+        totalColorChanges += renderStats.colorChanges;
+        totalBlendModeChanges += renderStats.blendModeChanges;
+        cout << frame << "," << ms << "," << renderStats.drawCalls << "," << renderStats.textureSwitches << ","
+             << renderStats.colorChanges << "," << renderStats.blendModeChanges << endl;
+
+        if (dumpPrefix) {
+            char path[256];
+            SDL_snprintf(path, sizeof(path), "%s_%04d.bmp", dumpPrefix, frame);
+            if (SDL_SaveBMP(game.offscreen, path) < 0) {
+                cerr << "Failed to save frame " << path << "! SDL_Error: " << SDL_GetError() << endl;
+            }
+        }
+    }
+
+    if (frames > 0) {
+        cout << "# enemies=" << enemyCount << " frames=" << frames
+             << " avg_ms=" << totalMs / frames << " max_ms=" << maxMs
+             << " avg_draw_calls=" << (double)totalDrawCalls / frames
+             << " avg_texture_switches=" << (double)totalTextureSwitches / frames
+             << " avg_color_changes=" << (double)totalColorChanges / frames
+             << " avg_blend_mode_changes=" << (double)totalBlendModeChanges / frames << endl;
+    }
+    return 0;
+}
+
+// Đọc số nguyên không âm; false nếu chuỗi không phải số hoặc quá lớn
+bool parseCount(const char* text, int& value) {
+    char* end = nullptr;
+    errno = 0;
+    long result = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || result < 0 || result > INT_MAX) {
+        return false;
+    }
+    value = (int)result;
+    return true;
+}
+
 int main(int argc, char* argv[]) {
+    // game --bench <số địch> [số frame] [tiền tố file ảnh]
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+        int enemyCount = 0, frames = 300;
+        if (argc < 3 || argc > 5 || !parseCount(argv[2], enemyCount) ||
+            (argc >= 4 && !parseCount(argv[3], frames))) {
+            cerr << "Usage: " << argv[0] << " --bench <enemies> [frames] [frame_prefix]" << endl;
+            return 1;
+        }
+        return runBenchmark(enemyCount, frames, argc >= 5 ? argv[4] : nullptr);
+    }
+
+    // game --compile-level <level.txt> <level.lvl>
+    if (argc == 4 && strcmp(argv[1], "--compile-level") == 0) {
+        return compileLevel(argv[2], argv[3]) ? 0 : 1;
+    }
+
     srand(time(NULL));
     Game game;
     if (game.running) {